@@ -12,6 +12,7 @@
 #include "esp_random.h"
 #include "esp_system.h"
 #include "esp_rom_sys.h" // 新增：硬件延时头文件
+#include "keymap.h"
 
 // ==================== 核心配置参数 ====================
 // UART配置
@@ -51,6 +52,27 @@
 #define MOUSE_OPCODE       0x02
 #define MOUSE_BUTTON_BYTE  3
 #define MIDDLE_BUTTON_BIT  2
+#define MOUSE_X_BYTE       4
+#define MOUSE_Y_BYTE       5
+#define MOUSE_WHEEL_BYTE   6
+
+// 中键单击/拖动判定
+#define MIDDLE_CLICK_MAX_MS      250   // 按下到松开不超过该时长才算单击
+#define MIDDLE_DRAG_THRESHOLD    4     // 按住期间累计位移超过该值即判定为拖动
+#define MIDDLE_HOLD_MAX_FRAMES   8     // 判定期间最多暂存的帧数，超出按拖动处理
+
+// 键盘帧解析（57 AB 01 + 8字节HID报告，无校验和，重映射后无需修正）
+#define KEYBOARD_OPCODE        0x01
+#define KEYBOARD_FRAME_LENGTH  (3 + KEYMAP_REPORT_LENGTH)
+
+// 下行状态帧缓存（上位机→下位机，如键盘LED状态），切换后重放给下位机
+// 仅缓存 downstreamStateFrames 白名单中的状态帧
+#define DOWNSTREAM_CACHE_SLOTS     4     // 每台上位机最多缓存的状态帧种类数
+#define DOWNSTREAM_FRAME_MAX_LEN   16    // 状态帧最大长度（含帧头）
+
+// 各上位机键盘重映射档案（见 keymap_profiles.def）
+#define HOST_A_KEYMAP_PROFILE  KEYMAP_PROFILE_PASSTHROUGH
+#define HOST_B_KEYMAP_PROFILE  KEYMAP_PROFILE_PASSTHROUGH
 
 // WS2812配置
 #define LED_STRIP_GPIO_PIN         48
@@ -87,6 +109,33 @@ typedef enum {
     CONNECTED_TO_B
 } ConnectionState;
 
+// 鼠标中键状态机
+typedef enum {
+    MIDDLE_IDLE,        // 中键未按下
+    MIDDLE_PENDING,     // 已按下，暂存帧等待判定单击/拖动
+    MIDDLE_PASSTHROUGH  // 已判定为拖动/长按，透传直到松开
+} MiddleButtonState;
+
+// 下行状态帧类型（操作码 + 完整帧长，含57 AB帧头）
+typedef struct {
+    uint8_t opcode;
+    uint8_t len;
+} DownstreamFrameType;
+
+// 下行状态帧（每种类型保留最新一帧）
+typedef struct {
+    bool valid;
+    uint8_t data[DOWNSTREAM_FRAME_MAX_LEN];
+} DownstreamFrame;
+
+// 单台上位机的下行状态缓存
+typedef struct {
+    DownstreamFrame frames[DOWNSTREAM_CACHE_SLOTS]; // 与 downstreamStateFrames 一一对应
+    uint8_t rx[DOWNSTREAM_FRAME_MAX_LEN];           // 跨次读取重组中的帧
+    int rxLen;
+    int rxType;
+} DownstreamCache;
+
 // 呼吸灯颜色
 typedef enum {
     BREATH_COLOR_RED,
@@ -104,9 +153,16 @@ typedef struct {
 static const char *TAG = "ch9350_led_switch";
 
 // 连接状态
-static ConnectionState currentState = CONNECTED_TO_A;
+static volatile ConnectionState currentState = CONNECTED_TO_A;
 static volatile uint64_t lastSwitchTime = 0;
 static volatile bool mouse_middle_enable = true;
+
+// 鼠标中键状态机（仅在UART转发任务中访问）
+static MiddleButtonState middleState = MIDDLE_IDLE;
+static uint64_t middlePressTime = 0;
+static int middleMotion = 0;
+static uint8_t middleHeldFrames[MIDDLE_HOLD_MAX_FRAMES][FRAME_LENGTH];
+static int middleHeldCount = 0;
 // LED功能总开关
 static volatile bool led_function_enable = true;
 
@@ -117,6 +173,7 @@ static volatile bool k3_is_pressed = false;
 // 同步信号量/标志
 static SemaphoreHandle_t switchSemaphore = NULL;
 static SemaphoreHandle_t ledSemaphore = NULL;
+static SemaphoreHandle_t downstreamCacheMutex = NULL;
 static volatile gpio_num_t triggerGpio = GPIO_NUM_NC;
 static volatile BreathColor currentBreathColor = BREATH_COLOR_BLUE;
 static volatile bool led_stop_flag = false; // 呼吸灯停止标志
@@ -126,6 +183,21 @@ static QueueHandle_t uart_lower_queue = NULL;
 static QueueHandle_t uart_upper_a_queue = NULL;
 static QueueHandle_t uart_upper_b_queue = NULL;
 
+// 下位机→上位机帧重组缓冲区（跨次读取保留不完整的半帧，仅在UART转发任务中访问）
+static uint8_t lowerRxBuf[UART_DMA_BUFF_SIZE + KEYBOARD_FRAME_LENGTH];
+static int lowerRxLen = 0;
+static volatile bool lowerRxReset = false; // 切换时清空下位机输入，半帧随之作废
+
+// 下行状态帧白名单（命令/应答等其他帧只随当前上位机实时转发，不缓存不重放）
+static const DownstreamFrameType downstreamStateFrames[] = {
+    {0x12, 11}   // 状态帧（含键盘Caps/Num/Scroll Lock指示灯状态）
+};
+#define DOWNSTREAM_STATE_FRAME_COUNT (sizeof(downstreamStateFrames) / sizeof(DownstreamFrameType))
+_Static_assert(DOWNSTREAM_STATE_FRAME_COUNT <= DOWNSTREAM_CACHE_SLOTS, "下行状态帧白名单超出缓存容量");
+
+// 下行状态缓存（按ConnectionState索引，A/B两台上位机持续更新）
+static DownstreamCache downstreamCache[2];
+
 // LED颜色池
 static const rgb_color_t burst_color_pool[] = {
     {255, 0, 0},     // 红
@@ -141,16 +213,22 @@ static const rgb_color_t burst_color_pool[] = {
 // ==================== 函数声明 ====================
 // UART相关
 static uart_port_t getActiveUpperUart(void);
-static QueueHandle_t getActiveUpperUartQueue(void);
+static ConnectionState getUpperUartHost(uart_port_t uart);
+static const keymap_profile_t *getActiveKeymap(void);
 static void uart_config(void);
 static void handleUartInterruptEvent(QueueHandle_t uart_queue, uart_port_t src_uart, uart_port_t dest_uart);
 static void uart_forward_task(void *arg); // 新增：UART转发独立任务
+static void cacheDownstreamFrames(ConnectionState host, const uint8_t *buf, int len);
+static void replayDownstreamCache(ConnectionState host);
 
 // 切换逻辑
-static void switchConnection(void);
+static bool switchConnection(void);
 static void toggleMouseMiddleFunc(void);
 static void toggleLedFunction(void);
 static bool parseMouseFrame(uint8_t *frame, int len);
+static void releaseMiddleHeldFrames(void);
+static void pollMiddleButtonTimeout(void);
+static void forwardLowerFrames(const uint8_t *data, int len, uart_port_t dest_uart);
 
 // GPIO中断
 static void IRAM_ATTR gpio_isr_handler(void *arg);
@@ -228,9 +306,10 @@ static void uart_config() {
 }
 
 // ==================== 连接切换逻辑 ====================
-static void switchConnection() {
+// 返回是否实际完成切换（锁定期内返回false）
+static bool switchConnection() {
     uint64_t t = esp_timer_get_time() / 1000;
-    if (t - lastSwitchTime <= SWITCH_LOCKOUT_MS) return;
+    if (t - lastSwitchTime <= SWITCH_LOCKOUT_MS) return false;
     lastSwitchTime = t;
 
     // 1. 立即停止当前呼吸灯
@@ -238,7 +317,8 @@ static void switchConnection() {
     rmt_send_ws2812_color(0, 0, 0); // 强制熄灭LED
     vTaskDelay(pdMS_TO_TICKS(10));  // 确保停止信号生效
 
-    // 2. 切换连接状态
+    // 2. 切换连接状态（持锁直到重放完成，避免转发任务在切换后再写入旧上位机的状态帧）
+    xSemaphoreTake(downstreamCacheMutex, portMAX_DELAY);
     ConnectionState oldState = currentState;
     currentState = (currentState == CONNECTED_TO_A) ? CONNECTED_TO_B : CONNECTED_TO_A;
     const char* target = (currentState == CONNECTED_TO_A) ? "上位机A" : "上位机B";
@@ -246,16 +326,20 @@ static void switchConnection() {
     // 3. 设置新呼吸灯颜色
     currentBreathColor = (currentState == CONNECTED_TO_A) ? BREATH_COLOR_BLUE : BREATH_COLOR_RED;
 
-    // 4. 清空UART缓冲区
-    uart_flush_input(getActiveUpperUart());
+    // 4. 清空下位机接收缓冲区，并向下位机重放新上位机的状态帧（键盘LED等）
+    lowerRxReset = true;
     uart_flush_input(UART_LOWER_NUM);
+    replayDownstreamCache(currentState);
+    xSemaphoreGive(downstreamCacheMutex);
 
-    ESP_LOGI(TAG, "[K1/中键] 切换到 %s，呼吸灯颜色：%s", 
+    ESP_LOGI(TAG, "[K1/中键] 切换到 %s，呼吸灯颜色：%s，键盘档案：%s", 
              target, 
-             (currentBreathColor == BREATH_COLOR_RED) ? "红色" : "蓝色");
+             (currentBreathColor == BREATH_COLOR_RED) ? "红色" : "蓝色",
+             getActiveKeymap()->name);
 
     // 5. 触发LED任务（执行新特效）
     xSemaphoreGive(ledSemaphore);
+    return true;
 }
 
 static void toggleMouseMiddleFunc() {
@@ -288,8 +372,14 @@ static void toggleLedFunction() {
 }
 
 // ==================== 鼠标帧解析 ====================
+// 中键按下时先暂存帧：短按松开判定为单击 → 切换上位机并丢弃暂存帧；
+// 出现位移、其他按键变化、超时或暂存满则判定为拖动/长按 → 按原顺序
+// 放行暂存帧并透传至松开。返回true表示该帧已由状态机接管，调用方不再转发。
 static bool parseMouseFrame(uint8_t *frame, int len) {
-    if (!mouse_middle_enable) return false;
+    if (!mouse_middle_enable) {
+        releaseMiddleHeldFrames();
+        return false;
+    }
 
     if (len != FRAME_LENGTH ||
         frame[0] != MOUSE_FRAME_HEADER1 ||
@@ -298,15 +388,138 @@ static bool parseMouseFrame(uint8_t *frame, int len) {
         return false;
     }
 
-    if (((frame[MOUSE_BUTTON_BYTE] >> MIDDLE_BUTTON_BIT) & 0x01) == 1) {
-        ESP_LOGD(TAG, "[鼠标中键触发] 中键按下 → 切换上位机（此帧不转发）");
-        switchConnection();
+    bool middle = ((frame[MOUSE_BUTTON_BYTE] >> MIDDLE_BUTTON_BIT) & 0x01) == 1;
+
+    switch (middleState) {
+        case MIDDLE_IDLE:
+            if (!middle) return false;
+            middleState = MIDDLE_PENDING;
+            middlePressTime = esp_timer_get_time() / 1000;
+            middleMotion = 0;
+            middleHeldCount = 0;
+            break;
+
+        case MIDDLE_PASSTHROUGH:
+            if (!middle) middleState = MIDDLE_IDLE;
+            return false;
+
+        case MIDDLE_PENDING:
+            break;
+    }
+
+    // MIDDLE_PENDING：累计位移并判定
+    middleMotion += abs((int8_t)frame[MOUSE_X_BYTE]) +
+                    abs((int8_t)frame[MOUSE_Y_BYTE]) +
+                    abs((int8_t)frame[MOUSE_WHEEL_BYTE]);
+    bool otherButtons = (frame[MOUSE_BUTTON_BYTE] & ~(1 << MIDDLE_BUTTON_BIT)) != 0;
+    uint64_t elapsed = esp_timer_get_time() / 1000 - middlePressTime;
+
+    if (!middle && !otherButtons && middleMotion <= MIDDLE_DRAG_THRESHOLD && elapsed <= MIDDLE_CLICK_MAX_MS) {
+        if (switchConnection()) {
+            ESP_LOGD(TAG, "[鼠标中键触发] 中键单击 → 切换上位机（丢弃%d帧）", middleHeldCount + 1);
+            middleState = MIDDLE_IDLE;
+            middleHeldCount = 0;
+            return true;
+        }
+
+        // 切换锁定期内：单击原样交给上位机（放行暂存帧，松开帧由调用方转发）
+        ESP_LOGD(TAG, "[鼠标中键] 切换锁定中 → 单击透传（放行%d帧）", middleHeldCount);
+        releaseMiddleHeldFrames();
+        middleState = MIDDLE_IDLE;
+        return false;
+    }
+
+    if (middle && !otherButtons && middleMotion <= MIDDLE_DRAG_THRESHOLD &&
+        elapsed <= MIDDLE_CLICK_MAX_MS && middleHeldCount < MIDDLE_HOLD_MAX_FRAMES) {
+        memcpy(middleHeldFrames[middleHeldCount++], frame, FRAME_LENGTH);
         return true;
     }
 
+    // 拖动/长按：放行暂存帧，当前帧由调用方紧随其后转发
+    ESP_LOGD(TAG, "[鼠标中键] 判定为拖动/长按 → 透传（放行%d帧）", middleHeldCount);
+    releaseMiddleHeldFrames();
+    middleState = middle ? MIDDLE_PASSTHROUGH : MIDDLE_IDLE;
     return false;
 }
 
+// 按原顺序放行暂存的中键帧，状态机转入透传
+static void releaseMiddleHeldFrames() {
+    if (middleState != MIDDLE_PENDING) return;
+
+    uart_port_t dest = getActiveUpperUart();
+    for (int i = 0; i < middleHeldCount; i++) {
+        uart_write_bytes(dest, (const char*)middleHeldFrames[i], FRAME_LENGTH);
+    }
+    middleHeldCount = 0;
+    middleState = MIDDLE_PASSTHROUGH;
+}
+
+// 鼠标静止按住中键时不再上报新帧，由转发任务轮询超时并按长按处理
+static void pollMiddleButtonTimeout() {
+    if (middleState != MIDDLE_PENDING) return;
+
+    if (!mouse_middle_enable ||
+        esp_timer_get_time() / 1000 - middlePressTime > MIDDLE_CLICK_MAX_MS) {
+        ESP_LOGD(TAG, "[鼠标中键] 按住超时 → 按长按透传（放行%d帧）", middleHeldCount);
+        releaseMiddleHeldFrames();
+    }
+}
+
+// ==================== 下位机帧重组与转发 ====================
+// 将读到的数据拼接到上次残留的半帧之后，按帧头切分：
+// 键盘帧按当前上位机档案重映射，鼠标帧交由中键状态机判定，其余字节原样转发；
+// 末尾不完整的帧留待下次读取补全后再处理
+static void forwardLowerFrames(const uint8_t *data, int len, uart_port_t dest_uart) {
+    if (lowerRxReset) {
+        lowerRxReset = false;
+        lowerRxLen = 0;
+    }
+
+    // 残留半帧不足一个键盘帧长，拼接后不会越界
+    memcpy(&lowerRxBuf[lowerRxLen], data, len);
+    lowerRxLen += len;
+
+    const keymap_profile_t *profile = getActiveKeymap();
+    int pos = 0;
+    int sent = 0;
+
+    while (pos < lowerRxLen) {
+        uint8_t *frame = &lowerRxBuf[pos];
+        int avail = lowerRxLen - pos;
+
+        if (frame[0] != MOUSE_FRAME_HEADER1 ||
+            (avail >= 2 && frame[1] != MOUSE_FRAME_HEADER2)) {
+            pos++;
+            continue;
+        }
+        if (avail < 3) break; // 帧头不完整
+
+        if (frame[2] == KEYBOARD_OPCODE) {
+            if (avail < KEYBOARD_FRAME_LENGTH) break;
+            keymap_apply_report(profile, &frame[3]);
+            pos += KEYBOARD_FRAME_LENGTH;
+        } else if (frame[2] == MOUSE_OPCODE) {
+            if (avail < FRAME_LENGTH) break;
+            if (parseMouseFrame(frame, FRAME_LENGTH)) {
+                ESP_LOGD(TAG, "[阻止] 中键帧由状态机接管，暂不转发");
+                if (pos > sent) {
+                    uart_write_bytes(dest_uart, (const char*)&lowerRxBuf[sent], pos - sent);
+                }
+                sent = pos + FRAME_LENGTH;
+            }
+            pos += FRAME_LENGTH;
+        } else {
+            pos += 3; // 其他帧原样转发
+        }
+    }
+
+    if (pos > sent) {
+        uart_write_bytes(dest_uart, (const char*)&lowerRxBuf[sent], pos - sent);
+    }
+    lowerRxLen -= pos;
+    memmove(lowerRxBuf, &lowerRxBuf[pos], lowerRxLen);
+}
+
 // ==================== GPIO中断 ====================
 static void IRAM_ATTR gpio_isr_handler(void *arg) {
     gpio_num_t gpio = (gpio_num_t)arg;
@@ -391,26 +604,17 @@ static void handleUartInterruptEvent(QueueHandle_t uart_queue,
             case UART_DATA:
                 len = uart_read_bytes(src_uart, buf, event.size, pdMS_TO_TICKS(10));
                 if (len > 0) {
-                    bool block = false;
-
                     if (src_uart == UART_LOWER_NUM) {
-                        int pos = 0;
-                        while (pos + FRAME_LENGTH <= len) {
-                            block = parseMouseFrame(&buf[pos], FRAME_LENGTH);
-                            if (block) {
-                                pos += FRAME_LENGTH;
-                                ESP_LOGD(TAG, "[阻止] 中键帧已被丢弃，不转发");
-                                block = true;
-                            } else {
-                                uart_write_bytes(dest_uart, (const char*)&buf[pos], FRAME_LENGTH);
-                                pos += FRAME_LENGTH;
-                            }
-                        }
-                        if (pos < len && !block) {
-                            uart_write_bytes(dest_uart, (const char*)&buf[pos], len - pos);
-                        }
+                        forwardLowerFrames(buf, len, dest_uart);
                     } else {
-                        uart_write_bytes(dest_uart, (const char*)buf, len);
+                        // 上位机→下位机：两台上位机均持续缓存状态帧，仅当前上位机转发
+                        // 判定与写入在锁内完成，与switchConnection的切换+重放互斥
+                        xSemaphoreTake(downstreamCacheMutex, portMAX_DELAY);
+                        cacheDownstreamFrames(getUpperUartHost(src_uart), buf, len);
+                        if (src_uart == getActiveUpperUart()) {
+                            uart_write_bytes(dest_uart, (const char*)buf, len);
+                        }
+                        xSemaphoreGive(downstreamCacheMutex);
                     }
                 }
                 break;
@@ -419,12 +623,14 @@ static void handleUartInterruptEvent(QueueHandle_t uart_queue,
                 ESP_LOGE(TAG, "UART(%d) FIFO溢出！清空缓冲区", src_uart);
                 uart_flush_input(src_uart);
                 xQueueReset(uart_queue);
+                if (src_uart == UART_LOWER_NUM) lowerRxLen = 0;
                 break;
 
             case UART_BUFFER_FULL:
                 ESP_LOGE(TAG, "UART(%d)缓冲区满！清空缓冲区", src_uart);
                 uart_flush_input(src_uart);
                 xQueueReset(uart_queue);
+                if (src_uart == UART_LOWER_NUM) lowerRxLen = 0;
                 break;
 
             default:
@@ -439,21 +645,85 @@ static void uart_forward_task(void *arg) {
     while (1) {
         // 处理下位机→当前激活的上位机
         handleUartInterruptEvent(uart_lower_queue, UART_LOWER_NUM, getActiveUpperUart());
+        // 中键按住无新帧时的超时判定
+        pollMiddleButtonTimeout();
         // 处理当前激活的上位机→下位机
-        handleUartInterruptEvent(getActiveUpperUartQueue(), getActiveUpperUart(), UART_LOWER_NUM);
+        // 两台上位机→下位机（非当前上位机只更新状态缓存，不转发）
+        handleUartInterruptEvent(uart_upper_a_queue, UART_UPPER_A_NUM, UART_LOWER_NUM);
+        handleUartInterruptEvent(uart_upper_b_queue, UART_UPPER_B_NUM, UART_LOWER_NUM);
         // 低频率轮询，降低CPU占用
         vTaskDelay(pdMS_TO_TICKS(2));
     }
     vTaskDelete(NULL);
 }
 
+// ==================== 下行状态缓存 ====================
+// 逐字节重组白名单状态帧（可跨多次读取），帧完整后才写入缓存；
+// 非白名单操作码的帧直接跳过，重新寻找帧头。调用方需持有downstreamCacheMutex
+static void cacheDownstreamFrames(ConnectionState host, const uint8_t *buf, int len) {
+    DownstreamCache *cache = &downstreamCache[host];
+
+    for (int i = 0; i < len; i++) {
+        uint8_t b = buf[i];
+
+        if (cache->rxLen == 0) {
+            if (b == MOUSE_FRAME_HEADER1) cache->rx[cache->rxLen++] = b;
+            continue;
+        }
+        if (cache->rxLen == 1) {
+            if (b == MOUSE_FRAME_HEADER2) {
+                cache->rx[cache->rxLen++] = b;
+            } else if (b != MOUSE_FRAME_HEADER1) {
+                cache->rxLen = 0;
+            }
+            continue;
+        }
+        if (cache->rxLen == 2) {
+            cache->rxType = -1;
+            for (int t = 0; t < (int)DOWNSTREAM_STATE_FRAME_COUNT; t++) {
+                if (downstreamStateFrames[t].opcode == b) cache->rxType = t;
+            }
+            if (cache->rxType < 0) {
+                cache->rxLen = 0;
+                continue;
+            }
+        }
+
+        cache->rx[cache->rxLen++] = b;
+        if (cache->rxLen == downstreamStateFrames[cache->rxType].len) {
+            DownstreamFrame *frame = &cache->frames[cache->rxType];
+
+            memcpy(frame->data, cache->rx, cache->rxLen);
+            frame->valid = true;
+            cache->rxLen = 0;
+        }
+    }
+}
+
+// 将上位机的缓存状态帧重放给下位机（调用方需持有downstreamCacheMutex）
+static void replayDownstreamCache(ConnectionState host) {
+    const DownstreamCache *cache = &downstreamCache[host];
+    int replayed = 0;
+
+    for (int t = 0; t < (int)DOWNSTREAM_STATE_FRAME_COUNT; t++) {
+        if (!cache->frames[t].valid) continue;
+        uart_write_bytes(UART_LOWER_NUM, (const char*)cache->frames[t].data, downstreamStateFrames[t].len);
+        replayed++;
+    }
+    ESP_LOGD(TAG, "已向下位机重放%d帧下行状态", replayed);
+}
+
 // ==================== 辅助函数 ====================
 static uart_port_t getActiveUpperUart() {
     return (currentState == CONNECTED_TO_A) ? UART_UPPER_A_NUM : UART_UPPER_B_NUM;
 }
 
-static QueueHandle_t getActiveUpperUartQueue() {
-    return (currentState == CONNECTED_TO_A) ? uart_upper_a_queue : uart_upper_b_queue;
+static ConnectionState getUpperUartHost(uart_port_t uart) {
+    return (uart == UART_UPPER_A_NUM) ? CONNECTED_TO_A : CONNECTED_TO_B;
+}
+
+static const keymap_profile_t *getActiveKeymap() {
+    return &keymap_profiles[(currentState == CONNECTED_TO_A) ? HOST_A_KEYMAP_PROFILE : HOST_B_KEYMAP_PROFILE];
 }
 
 // ==================== WS2812 LED控制 ====================
@@ -686,6 +956,7 @@ void app_main(void) {
 
     // 初始化信号量
     ledSemaphore = xSemaphoreCreateBinary();
+    downstreamCacheMutex = xSemaphoreCreateMutex();
 
     // 初始化UART
     uart_config();
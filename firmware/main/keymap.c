@@ -0,0 +1,42 @@
+#include "keymap.h"
+
+// ==================== 编译期查表生成 ====================
+// 以行为单位展开0x00~0xFF共256项，F(arg, 索引) 计算每一项
+#define KEYMAP_ROW(F, arg, r) \
+    F(arg, (r) + 0x0), F(arg, (r) + 0x1), F(arg, (r) + 0x2), F(arg, (r) + 0x3), \
+    F(arg, (r) + 0x4), F(arg, (r) + 0x5), F(arg, (r) + 0x6), F(arg, (r) + 0x7), \
+    F(arg, (r) + 0x8), F(arg, (r) + 0x9), F(arg, (r) + 0xA), F(arg, (r) + 0xB), \
+    F(arg, (r) + 0xC), F(arg, (r) + 0xD), F(arg, (r) + 0xE), F(arg, (r) + 0xF)
+
+#define KEYMAP_TABLE(F, arg) { \
+    KEYMAP_ROW(F, arg, 0x00), KEYMAP_ROW(F, arg, 0x10), KEYMAP_ROW(F, arg, 0x20), KEYMAP_ROW(F, arg, 0x30), \
+    KEYMAP_ROW(F, arg, 0x40), KEYMAP_ROW(F, arg, 0x50), KEYMAP_ROW(F, arg, 0x60), KEYMAP_ROW(F, arg, 0x70), \
+    KEYMAP_ROW(F, arg, 0x80), KEYMAP_ROW(F, arg, 0x90), KEYMAP_ROW(F, arg, 0xA0), KEYMAP_ROW(F, arg, 0xB0), \
+    KEYMAP_ROW(F, arg, 0xC0), KEYMAP_ROW(F, arg, 0xD0), KEYMAP_ROW(F, arg, 0xE0), KEYMAP_ROW(F, arg, 0xF0) }
+
+// 键码：依次匹配映射列表，均未命中则原样输出
+#define KEYMAP_NO_KEYS(X, kc)
+#define KEYMAP_KEY_MATCH(kc, from, to) ((kc) == (from)) ? (to) :
+#define KEYMAP_KEY_ENTRY(keys, kc) (uint8_t)(keys(KEYMAP_KEY_MATCH, kc) (kc))
+
+// 修饰键：源位i移动到目标位p_i
+#define KEYMAP_UNPACK(...) __VA_ARGS__
+#define KEYMAP_MOD_PERMUTE(m, p0, p1, p2, p3, p4, p5, p6, p7) \
+    ((((m) >> 0 & 1) << (p0)) | (((m) >> 1 & 1) << (p1)) | \
+     (((m) >> 2 & 1) << (p2)) | (((m) >> 3 & 1) << (p3)) | \
+     (((m) >> 4 & 1) << (p4)) | (((m) >> 5 & 1) << (p5)) | \
+     (((m) >> 6 & 1) << (p6)) | (((m) >> 7 & 1) << (p7)))
+#define KEYMAP_MOD_PERMUTE_I(...) KEYMAP_MOD_PERMUTE(__VA_ARGS__)
+#define KEYMAP_MOD_ENTRY(mods, m) (uint8_t)KEYMAP_MOD_PERMUTE_I(m, KEYMAP_UNPACK mods)
+
+// ==================== 档案表 ====================
+const keymap_profile_t keymap_profiles[KEYMAP_PROFILE_COUNT] = {
+#define KEYMAP_PROFILE(id, mods, keys) \
+    [KEYMAP_PROFILE_##id] = { \
+        .name = #id, \
+        .keycode = KEYMAP_TABLE(KEYMAP_KEY_ENTRY, keys), \
+        .modifier = KEYMAP_TABLE(KEYMAP_MOD_ENTRY, mods), \
+    },
+#include "keymap_profiles.def"
+#undef KEYMAP_PROFILE
+};
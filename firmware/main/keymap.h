@@ -0,0 +1,42 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdint.h>
+
+// 键盘HID报告（8字节）：修饰键、保留字节、6个键码
+#define KEYMAP_REPORT_LENGTH   8
+#define KEYMAP_REPORT_MOD_BYTE 0
+#define KEYMAP_REPORT_KEY_BYTE 2
+#define KEYMAP_REPORT_KEY_NUM  6
+
+// 重映射档案ID（由 keymap_profiles.def 生成）
+typedef enum {
+#define KEYMAP_PROFILE(id, mods, keys) KEYMAP_PROFILE_##id,
+#include "keymap_profiles.def"
+#undef KEYMAP_PROFILE
+    KEYMAP_PROFILE_COUNT
+} keymap_profile_id_t;
+
+// 重映射档案：键码表 + 修饰键置换表，均为编译期常量
+typedef struct {
+    const char *name;
+    uint8_t keycode[256];
+    uint8_t modifier[256];
+} keymap_profile_t;
+
+extern const keymap_profile_t keymap_profiles[KEYMAP_PROFILE_COUNT];
+
+// 原地重映射一帧键盘HID报告（纯查表，无分支，不依赖ESP-IDF，可在主机上编译测试）
+static inline void keymap_apply_report(const keymap_profile_t *profile, uint8_t *report) {
+    uint8_t *keys = &report[KEYMAP_REPORT_KEY_BYTE];
+
+    report[KEYMAP_REPORT_MOD_BYTE] = profile->modifier[report[KEYMAP_REPORT_MOD_BYTE]];
+    keys[0] = profile->keycode[keys[0]];
+    keys[1] = profile->keycode[keys[1]];
+    keys[2] = profile->keycode[keys[2]];
+    keys[3] = profile->keycode[keys[3]];
+    keys[4] = profile->keycode[keys[4]];
+    keys[5] = profile->keycode[keys[5]];
+}
+
+#endif // KEYMAP_H
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+#include "keymap.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+// 逐位置换修饰键（参考实现），perm[i]为源位i的目标位
+static uint8_t permute_modifier(uint8_t m, const int perm[8]) {
+    uint8_t out = 0;
+    for (int i = 0; i < 8; i++) {
+        if (m & (1 << i)) out |= (uint8_t)(1 << perm[i]);
+    }
+    return out;
+}
+
+// PASSTHROUGH：键码与修饰键均为恒等映射
+static void test_passthrough_identity(void) {
+    const keymap_profile_t *p = &keymap_profiles[KEYMAP_PROFILE_PASSTHROUGH];
+
+    for (int i = 0; i < 256; i++) {
+        CHECK(p->keycode[i] == i, "PASSTHROUGH keycode[0x%02X] = 0x%02X", i, p->keycode[i]);
+        CHECK(p->modifier[i] == i, "PASSTHROUGH modifier[0x%02X] = 0x%02X", i, p->modifier[i]);
+    }
+}
+
+// MACOS：修饰键 bit0↔bit3、bit4↔bit7 互换，键码仅 Insert → Help
+static void test_macos_profile(void) {
+    static const int perm[8] = {3, 1, 2, 0, 7, 5, 6, 4};
+    const keymap_profile_t *p = &keymap_profiles[KEYMAP_PROFILE_MACOS];
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t expect = permute_modifier((uint8_t)i, perm);
+        CHECK(p->modifier[i] == expect, "MACOS modifier[0x%02X] = 0x%02X, expect 0x%02X", i, p->modifier[i], expect);
+
+        uint8_t key = (i == 0x49) ? 0x75 : (uint8_t)i;
+        CHECK(p->keycode[i] == key, "MACOS keycode[0x%02X] = 0x%02X, expect 0x%02X", i, p->keycode[i], key);
+    }
+}
+
+// keymap_apply_report：只改写修饰键字节与6个键码，保留字节不变
+static void test_apply_report(void) {
+    const keymap_profile_t *p = &keymap_profiles[KEYMAP_PROFILE_MACOS];
+    uint8_t report[KEYMAP_REPORT_LENGTH + 2] = {0x01, 0xA5, 0x49, 0x04, 0x05, 0x06, 0x07, 0x49, 0xEE, 0xEE};
+    const uint8_t expect[KEYMAP_REPORT_LENGTH + 2] = {0x08, 0xA5, 0x75, 0x04, 0x05, 0x06, 0x07, 0x75, 0xEE, 0xEE};
+
+    keymap_apply_report(p, report);
+    CHECK(memcmp(report, expect, sizeof(expect)) == 0, "MACOS report remap mismatch");
+
+    const uint8_t original[KEYMAP_REPORT_LENGTH] = {0x81, 0x5A, 0x49, 0x39, 0xE0, 0x00, 0xFF, 0x75};
+    memcpy(report, original, sizeof(original));
+    keymap_apply_report(&keymap_profiles[KEYMAP_PROFILE_PASSTHROUGH], report);
+    CHECK(memcmp(report, original, sizeof(original)) == 0, "PASSTHROUGH report changed");
+}
+
+int main(void) {
+    test_passthrough_identity();
+    test_macos_profile();
+    test_apply_report();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all keymap checks passed\n");
+    return 0;
+}